@@ -1,11 +1,11 @@
 #include "src/ParseArgs.h"
 #include "src/FileWorking.h"
-#include "src/Filters.h"
+#include "src/Pipeline.h"
 #include "src/Help.h"
+#include "src/Kernels.h"
+#include "src/Workers.h"
 #include <iostream>
 #include <exception>
-#include <stdexcept>
-#include <format>
 
 int main(int argc, char** argv) {
     if (argc == 1) {
@@ -14,17 +14,17 @@ int main(int argc, char** argv) {
     }
     try {
         Args parsed_args = ParseArgs(argc, argv);
-        Image image = ReadBMP(parsed_args.files.input);
-        auto filters_map = GetFilters();
-        for (const FilterArgs& cur_arg : parsed_args.args) {
-            if (!filters_map.contains(cur_arg.name)) {
-                throw std::invalid_argument(std::format("Cant find filter with name {}", cur_arg.name));
-            }
-            std::unique_ptr<Filter> cur_filter = filters_map[cur_arg.name](cur_arg.params);
-            image = cur_filter->Apply(image);
+        SelectKernels(parsed_args.options.isa.empty() ? DetectIsa() : ParseIsa(parsed_args.options.isa));
+        StartWorkers(parsed_args.options.threads.empty() ? 0 : ParseThreadCount(parsed_args.options.threads));
+        FilterChain chain = CreateFilterChain(parsed_args.args);
+        size_t scale = parsed_args.options.preview.empty() ? 1 : ParsePreviewScale(parsed_args.options.preview);
+        DownscaleChain(chain, scale);
+        MemoryPlan plan = {0};
+        if (!parsed_args.options.max_memory.empty()) {
+            plan = PlanMemory(ReadBMPSize(parsed_args.files.input, scale), chain,
+                              ParseMemorySize(parsed_args.options.max_memory));
         }
-        WriteBMP(image, parsed_args.files.output);
-
+        RunChain(parsed_args.files, chain, plan, scale);
     } catch (const std::exception& exception) {
         std::cerr << exception.what();
         return 1;
@@ -1,3 +1,4 @@
+#pragma once
 #include <string>
 #include <vector>
 
@@ -11,7 +12,15 @@ struct FilesPaths {
     std::string output;
 };
 
+struct Options {
+    std::string isa;
+    std::string max_memory;
+    std::string preview;
+    std::string threads;
+};
+
 struct Args {
     FilesPaths files;
+    Options options;
     std::vector<FilterArgs> args;
 };
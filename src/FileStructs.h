@@ -19,4 +19,11 @@ struct BMPinfoheader {
     int32_t vertical_resolution;
     int32_t colors_palette;
     int32_t colors_used;
+};
+
+struct BMPbitfields {
+    uint32_t red;
+    uint32_t green;
+    uint32_t blue;
+    uint32_t alpha;
 };
\ No newline at end of file
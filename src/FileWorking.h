@@ -1,5 +1,24 @@
+#pragma once
 #include "Image.h"
+#include <cstdint>
 #include <string>
 
-Image ReadBMP(std::string& path);
-void WriteBMP(const Image& image, std::string& path);
\ No newline at end of file
+// Pixel layout of a BMP file, the output keeps the layout of the input
+struct BMPLayout {
+    int16_t depth;        // 24 or 32 bits per pixel, alpha is the fourth byte of 32 bits pixels
+    int32_t compression;  // 0 (BI_RGB) or 3 (BI_BITFIELDS with BGRA masks), 3 only for 32 bits
+    bool top_down;
+    bool alpha_mask;  // BI_BITFIELDS with an alpha mask, written with BITMAPV4HEADER to keep it
+};
+
+// rows are counted from the top of the image, scale > 1 averages every scale x scale
+// block of the file into one pixel and counts rows and sizes in blocks
+ImageSize ReadBMPSize(std::string& path, size_t scale);
+BMPLayout ReadBMPLayout(std::string& path);
+Image ReadBMPRows(std::string& path, size_t first_row, size_t rows, size_t scale);
+
+void WriteBMP(const Image& image, std::string& path, const BMPLayout& layout);
+// A file is written by WriteBMPHeaders followed by AppendBMPRows calls in file order:
+// from the bottom of the image to the top, or from the top for top-down layout
+void WriteBMPHeaders(ImageSize size, std::string& path, const BMPLayout& layout);
+void AppendBMPRows(const Image& image, size_t first_row, size_t rows, std::string& path, const BMPLayout& layout);
\ No newline at end of file
@@ -1,3 +1,4 @@
+#pragma once
 #include "Image.h"
 #include <string>
 #include <memory>
@@ -7,6 +8,20 @@
 class Filter {
 public:
     virtual Image Apply(const Image& img) = 0;
+    virtual ImageSize OutputSize(ImageSize input) const {
+        return input;
+    }
+    // rows of context needed above and below every output row
+    virtual size_t Halo() const {
+        return 0;
+    }
+    // full input sized frames allocated by Apply besides the result
+    virtual size_t ScratchFrames() const {
+        return 0;
+    }
+    // adapts size dependent params to an image downscaled scale times in both dimensions
+    virtual void Downscale(size_t /*scale*/) {
+    }
     virtual ~Filter() = default;
 };
 
@@ -18,6 +33,8 @@ private:
 public:
     Crop(size_t width, size_t height);
     Image Apply(const Image& img) override;
+    ImageSize OutputSize(ImageSize input) const override;
+    void Downscale(size_t scale) override;
 };
 
 class Grayscale : public Filter {
@@ -37,11 +54,13 @@ private:
 public:
     explicit Matrix(std::vector<double> weights);
     Image Apply(const Image& img) override;
+    size_t Halo() const override;
 };
 
 class Sharpening : public Filter {
 public:
     Image Apply(const Image& img) override;
+    size_t Halo() const override;
 };
 
 class EdgeDetection : public Filter {
@@ -51,6 +70,8 @@ private:
 public:
     explicit EdgeDetection(double threshold);
     Image Apply(const Image& img) override;
+    size_t Halo() const override;
+    size_t ScratchFrames() const override;
 };
 
 class GaussianBlur : public Filter {
@@ -59,9 +80,14 @@ private:
     std::vector<double> dist_weight_;
     int delta_;
 
+    void CalculateWeights(int delta);
+
 public:
     explicit GaussianBlur(double sigma);
     Image Apply(const Image& img) override;
+    size_t Halo() const override;
+    size_t ScratchFrames() const override;
+    void Downscale(size_t scale) override;
 };
 
 std::unique_ptr<Filter> CreateCrop(const std::vector<std::string>& params);
@@ -1,7 +1,8 @@
 #include <iostream>
 
 void WriteHelp() {
-    std::cout << "This is an image processor which working with 24-bits images." << std::endl;
+    std::cout << "This is an image processor which working with 24 and 32-bits (BGRA) images, bottom-up or top-down."
+              << std::endl;
     std::cout << "Example for command line args:" << std::endl;
     std::cout << "image_processor {path to input file} {path to outpit file} [-{filter name 1} [filters param 1] "
                  "[filters param 2] ...] ..."
@@ -20,4 +21,19 @@ void WriteHelp() {
     std::cout << "  Border selection." << std::endl;
     std::cout << "6)Gaussian Blur (-blur sigma)" << std::endl;
     std::cout << "  Blur by Gaussian alghoritm." << std::endl;
+    std::cout << "Available options (--{option name} value, anywhere after the paths): " << std::endl;
+    std::cout << "1)Instruction set (--isa auto|generic|sse4|avx2|avx512)" << std::endl;
+    std::cout << "  Forces the pixel kernels variant. By default the best one for this CPU is used." << std::endl;
+    std::cout << "2)Memory budget (--max-memory bytes[K|M|G])" << std::endl;
+    std::cout << "  Processes the image in strips when the whole frame doesnt fit, refuses the job when even a strip"
+                 " doesnt fit."
+              << std::endl;
+    std::cout << "3)Preview (--preview scale)" << std::endl;
+    std::cout << "  Averages every scale x scale block of the input into one pixel, scales blur sigma and crop size "
+                 "to match and writes a scale times smaller image."
+              << std::endl;
+    std::cout << "4)Worker threads (--threads count)" << std::endl;
+    std::cout << "  Number of threads processing the image, one per CPU by default. On multi-socket hosts workers are"
+                 " pinned to NUMA nodes."
+              << std::endl;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include <cstdint>
+#include <memory>
+#include <utility>
 #include <vector>
 
 struct Pixel {
@@ -8,16 +10,58 @@ struct Pixel {
     double blue;
 };
 
+// Leaves pixels uninitialized on resize, so the pages of a frame are first touched by
+// the workers which process them and land on their NUMA node.
+template <class T>
+struct DefaultInitAllocator : std::allocator<T> {
+    template <class U>
+    struct rebind {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() = default;
+    template <class U>
+    DefaultInitAllocator(const DefaultInitAllocator<U>&) {
+    }
+
+    template <class U, class... Args>
+    void construct(U* pointer, Args&&... args) {
+        if constexpr (sizeof...(Args) == 0) {
+            ::new (static_cast<void*>(pointer)) U;
+        } else {
+            ::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+        }
+    }
+};
+
+struct ImageSize {
+    size_t width;
+    size_t height;
+};
+
+// length of a side averaged from blocks of scale pixels, a partial block on the edge counts too
+size_t ScaledLength(size_t length, size_t scale);
+
 class Image {
 private:
     size_t width_;
     size_t height_;
-    std::vector<Pixel> pixels_;
+    std::vector<Pixel, DefaultInitAllocator<Pixel>> pixels_;
+    std::vector<uint8_t, DefaultInitAllocator<uint8_t>> alpha_;  // empty for images without alpha
 
 public:
     Image(size_t width, size_t height);
     const Pixel& At(size_t x, size_t y) const;
     void Put(size_t x, size_t y, const Pixel& pixel);
+    const Pixel* Row(size_t x) const;
+    Pixel* Row(size_t x);
     size_t Width() const;
     size_t Height() const;
+    bool HasAlpha() const;
+    // allocates a fully opaque alpha plane
+    void AddAlpha();
+    const uint8_t* AlphaRow(size_t x) const;
+    uint8_t* AlphaRow(size_t x);
+    // takes the top left part of the alpha plane of an image at least this big, filters don't change alpha
+    void CopyAlpha(const Image& other);
 };
\ No newline at end of file
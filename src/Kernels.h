@@ -0,0 +1,36 @@
+#pragma once
+#include "Image.h"
+#include <cstdint>
+#include <string>
+
+enum class Isa { Generic, Sse4, Avx2, Avx512 };
+
+// Row kernels used by the hot loops. Every function works on one row of pixels
+// and writes already clamped values, so results can go straight into Image::Row.
+struct Kernels {
+    void (*decode_bgr)(const uint8_t* src, Pixel* dst, size_t width);
+    void (*encode_bgr)(const Pixel* src, uint8_t* dst, size_t width);
+    // 32 bits pixels, alpha goes to a separate plane. A null alpha is written as opaque
+    void (*decode_bgra)(const uint8_t* src, Pixel* dst, uint8_t* alpha, size_t width);
+    void (*encode_bgra)(const Pixel* src, const uint8_t* alpha, uint8_t* dst, size_t width);
+    void (*grayscale)(const Pixel* src, Pixel* dst, size_t width);
+    void (*negative)(const Pixel* src, Pixel* dst, size_t width);
+    void (*threshold)(const Pixel* src, Pixel* dst, size_t width, double threshold);
+    // weights order is the same as in Matrix: left, right, center, up, down
+    void (*stencil)(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width,
+                    const double* weights);
+    // stencil specialized for the constant weights of Sharpening and EdgeDetection
+    void (*sharpening)(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width);
+    void (*edge_detection)(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width);
+    void (*blur_row)(const Pixel* src, Pixel* dst, size_t width, const double* dist_weight, int delta);
+    // rows holds 2 * delta + 1 already clamped row pointers, from offset -delta to delta
+    void (*blur_column)(const Pixel* const* rows, Pixel* dst, size_t width, const double* dist_weight, int delta);
+};
+
+Isa DetectIsa();
+bool IsaSupported(Isa isa);
+Isa ParseIsa(const std::string& name);
+std::string IsaName(Isa isa);
+
+void SelectKernels(Isa isa);
+const Kernels& GetKernels();
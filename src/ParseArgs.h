@@ -1,3 +1,4 @@
+#pragma once
 #include "ArgStructs.h"
 
 Args ParseArgs(int argc, char** argv);
\ No newline at end of file
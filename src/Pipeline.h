@@ -0,0 +1,20 @@
+#pragma once
+#include "ArgStructs.h"
+#include "Filters.h"
+#include <vector>
+
+using FilterChain = std::vector<std::unique_ptr<Filter>>;
+
+struct MemoryPlan {
+    size_t strip_rows;  // output rows per strip, 0 when the chain runs on the whole frame
+};
+
+size_t ParseMemorySize(const std::string& s);
+size_t ParsePreviewScale(const std::string& s);
+size_t ParseThreadCount(const std::string& s);
+FilterChain CreateFilterChain(const std::vector<FilterArgs>& args);
+// scale > 1 runs the chain on a proxy averaged from scale x scale blocks of the input,
+// with size dependent filter params downscaled to match
+void DownscaleChain(FilterChain& chain, size_t scale);
+MemoryPlan PlanMemory(ImageSize input, const FilterChain& chain, size_t max_memory);
+void RunChain(FilesPaths& files, const FilterChain& chain, const MemoryPlan& plan, size_t scale);
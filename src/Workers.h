@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Fixed pool of worker threads for row parallel passes. Rows are split into one contiguous
+// band per worker and worker i always gets band i, so on a multi-socket host every part of a
+// frame is first touched and later processed by workers of the same NUMA node.
+// Workers are pinned to the CPUs of their node, consecutive workers share a node.
+void StartWorkers(size_t count);
+// Calls body(begin, end) for every non empty band of [0, rows) and waits for all of them.
+// The first exception thrown by a band is rethrown once every band has finished.
+void ForEachBand(size_t rows, const std::function<void(size_t, size_t)>& body);
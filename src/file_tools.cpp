@@ -1,8 +1,11 @@
 #include "FileWorking.h"
 #include "FileStructs.h"
+#include "Kernels.h"
 #include <fstream>
 #include <stdexcept>
 #include <algorithm>
+#include <climits>
+#include <vector>
 
 namespace {
 void FileReadBytes(char* pointer, std::ifstream& s, std::streamsize need) {
@@ -50,13 +53,6 @@ void Int16toByte(char* mas, int16_t number) {
     mas[1] = static_cast<char>((unumber >> 8) & 0xFF);  // NOLINT
 }
 
-uint8_t ReadUint8(std::ifstream& s) {
-    unsigned char lst[1];
-    FileReadBytes(reinterpret_cast<char*>(lst), s, 1);
-    uint8_t result = static_cast<uint8_t>(lst[0]);
-    return result;
-}
-
 BMPHeader ReadBMPHeader(std::ifstream& s) {
     BMPHeader result;
     FileReadBytes(result.magic, s, 2);
@@ -73,17 +69,35 @@ void CheckBmpHeadervalid(const BMPHeader header) {
     }
 }
 
-int32_t CalculateRawBitmapData(const Image& img, int32_t depth) {
-    return ((depth * static_cast<int32_t>(img.Width()) + 31) / 32) * 4 * static_cast<int32_t>(img.Height());  // NOLINT
+const int32_t bi_rgb = 0;
+const int32_t bi_bitfields = 3;
+const int16_t bgr_depth = 24;
+const int16_t bgra_depth = 32;
+const BMPbitfields bgra_bitfields = {0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000};
+const int32_t file_header_size = 14;
+const int32_t info_header_size = 40;
+const int32_t v4_header_size = 108;
+const uint32_t lcs_srgb = 0x73524742;  // 'sRGB' color space of BITMAPV4HEADER
+const int32_t v4_color_space_size = 48;  // endpoints and gamma, unused with sRGB
+
+int32_t InfoHeaderSize(const BMPLayout& layout) {
+    return layout.alpha_mask ? v4_header_size : info_header_size;
 }
 
-BMPHeader GenerateBmpHeader(const Image& image) {
-    const int32_t offset = 54;
-    const int32_t color_depth = 24;
+int32_t CalculateRawBitmapData(ImageSize size, int32_t depth) {
+    return ((depth * static_cast<int32_t>(size.width) + 31) / 32) * 4 * static_cast<int32_t>(size.height);  // NOLINT
+}
+
+BMPHeader GenerateBmpHeader(ImageSize image, const BMPLayout& layout) {
+    const int32_t bitfields_size = 12;  // masks after BITMAPINFOHEADER, bigger headers keep them inside
+    int32_t offset = file_header_size + InfoHeaderSize(layout);
+    if (layout.compression == bi_bitfields && !layout.alpha_mask) {
+        offset += bitfields_size;
+    }
     BMPHeader result;
     result.magic[0] = 'B';
     result.magic[1] = 'M';
-    result.file_size = CalculateRawBitmapData(image, color_depth) + offset;
+    result.file_size = CalculateRawBitmapData(image, layout.depth) + offset;
     result.reserved[0] = 0;
     result.reserved[1] = 0;
     result.offset = offset;
@@ -106,18 +120,29 @@ BMPinfoheader ReadBMPinfoheader(std::ifstream& s) {
     return result;
 }
 
+// BITMAPINFOHEADER keeps the masks right after itself, bigger headers keep them inside,
+// alpha mask is there only from BITMAPV3INFOHEADER on
+BMPbitfields ReadBMPbitfields(std::ifstream& s, const BMPinfoheader& infoheader) {
+    const int32_t alpha_mask_header_size = 56;
+    BMPbitfields result;
+    result.red = ReadUint32(s);
+    result.green = ReadUint32(s);
+    result.blue = ReadUint32(s);
+    result.alpha = infoheader.header_size >= alpha_mask_header_size ? ReadUint32(s) : 0;
+    return result;
+}
+
 void CheckBmpInfoHeadervalid(const BMPinfoheader& header) {
-    const int32_t color_depth = 24;
-    if (header.width < 0 || header.height < 0) {
+    if (header.width < 0 || header.height == INT32_MIN) {
         throw std::invalid_argument("Invalid input BMP. Non positive width or height");
     }
     if (header.color_planes != 1) {
         throw std::invalid_argument("Invalid input BMP. color planes isn`t 1");
     }
-    if (header.depth != color_depth) {
+    if (header.depth != bgr_depth && header.depth != bgra_depth) {
         throw std::invalid_argument("Invalid input BMP. Dont supported photo depth");
     }
-    if (header.compression != 0) {
+    if (header.compression != bi_rgb && (header.compression != bi_bitfields || header.depth != bgra_depth)) {
         throw std::invalid_argument("Invalid input BMP. Dont supported photo compression");
     }
     if (header.colors_palette != 0) {
@@ -125,18 +150,65 @@ void CheckBmpInfoHeadervalid(const BMPinfoheader& header) {
     }
 }
 
-BMPinfoheader GenerateBmpInfoHeader(const Image& image) {
+void CheckBmpBitfieldsValid(const BMPbitfields& bitfields) {
+    if (bitfields.red != bgra_bitfields.red || bitfields.green != bgra_bitfields.green ||
+        bitfields.blue != bgra_bitfields.blue || (bitfields.alpha != 0 && bitfields.alpha != bgra_bitfields.alpha)) {
+        throw std::invalid_argument("Invalid input BMP. Dont supported bitfields, only BGRA order is supported");
+    }
+}
+
+size_t ImageHeight(const BMPinfoheader& infoheader) {
+    return infoheader.height < 0 ? -static_cast<int64_t>(infoheader.height) : infoheader.height;
+}
+
+int64_t RowStride(int32_t width, int16_t depth) {
+    return ((static_cast<int64_t>(depth) * width + 31) / 32) * 4;  // NOLINT
+}
+
+// Checked up front, so a job never fails on reading after it has started writing the output.
+// Padding of the last row in the file may be missing.
+void CheckBmpDataSize(std::ifstream& s, const BMPHeader& header, const BMPinfoheader& infoheader) {
+    int64_t height = static_cast<int64_t>(ImageHeight(infoheader));
+    if (infoheader.width == 0 || height == 0) {
+        return;
+    }
+    int64_t last_row = static_cast<int64_t>(infoheader.width) * (infoheader.depth / 8);
+    int64_t need = static_cast<int64_t>(header.offset) + RowStride(infoheader.width, infoheader.depth) * (height - 1) +
+                   last_row;
+    std::streampos position = s.tellg();
+    s.seekg(0, std::ios::end);
+    int64_t file_size = s.tellg();
+    s.seekg(position);
+    if (need > file_size) {
+        throw std::invalid_argument("Invalid input BMP. Not enough bytes to read");
+    }
+}
+
+// returns the masks of BI_BITFIELDS files, zeros for BI_RGB
+BMPbitfields ReadHeaders(std::ifstream& s, BMPHeader& header, BMPinfoheader& infoheader) {
+    header = ReadBMPHeader(s);
+    CheckBmpHeadervalid(header);
+    infoheader = ReadBMPinfoheader(s);
+    CheckBmpInfoHeadervalid(infoheader);
+    BMPbitfields bitfields = {0, 0, 0, 0};
+    if (infoheader.compression == bi_bitfields) {
+        bitfields = ReadBMPbitfields(s, infoheader);
+        CheckBmpBitfieldsValid(bitfields);
+    }
+    CheckBmpDataSize(s, header, infoheader);
+    return bitfields;
+}
+
+BMPinfoheader GenerateBmpInfoHeader(ImageSize image, const BMPLayout& layout) {
     const int32_t dpi = 1337;
-    const int32_t color_depth = 24;
-    const int32_t header_size = 40;
     BMPinfoheader result;
-    result.header_size = header_size;
-    result.width = static_cast<int32_t>(image.Width());
-    result.height = static_cast<int32_t>(image.Height());
+    result.header_size = InfoHeaderSize(layout);
+    result.width = static_cast<int32_t>(image.width);
+    result.height = static_cast<int32_t>(image.height) * (layout.top_down ? -1 : 1);
     result.color_planes = 1;
-    result.depth = color_depth;
-    result.compression = 0;
-    result.raw_bitmap_data = CalculateRawBitmapData(image, color_depth);
+    result.depth = layout.depth;
+    result.compression = layout.compression;
+    result.raw_bitmap_data = CalculateRawBitmapData(image, layout.depth);
     result.horizontal_resolution = dpi;
     result.vertical_resolution = dpi;
     result.colors_palette = 0;
@@ -144,14 +216,6 @@ BMPinfoheader GenerateBmpInfoHeader(const Image& image) {
     return result;
 }
 
-Pixel ReadBmpPixel(std::ifstream& s) {
-    const double max_uint8_size = 255.0;
-    double blue = (static_cast<double>(ReadUint8(s))) / max_uint8_size;
-    double green = (static_cast<double>(ReadUint8(s))) / max_uint8_size;
-    double red = (static_cast<double>(ReadUint8(s))) / max_uint8_size;
-    return Pixel{red, green, blue};
-}
-
 void WriteHeaders(BMPHeader header, BMPinfoheader infoheader, std::ofstream& s) {
     s.write(header.magic, 2);
     char cur_16[2];
@@ -187,28 +251,116 @@ void WriteHeaders(BMPHeader header, BMPinfoheader infoheader, std::ofstream& s)
     s.write(cur_32, 4);
     Int32toByte(cur_32, infoheader.colors_used);
     s.write(cur_32, 4);
+    if (infoheader.header_size == v4_header_size) {
+        for (uint32_t field : {bgra_bitfields.red, bgra_bitfields.green, bgra_bitfields.blue, bgra_bitfields.alpha,
+                               lcs_srgb}) {
+            Int32toByte(cur_32, static_cast<int32_t>(field));
+            s.write(cur_32, 4);
+        }
+        const char color_space[v4_color_space_size] = {};
+        s.write(color_space, v4_color_space_size);
+    } else if (infoheader.compression == bi_bitfields) {
+        for (uint32_t mask : {bgra_bitfields.red, bgra_bitfields.green, bgra_bitfields.blue}) {
+            Int32toByte(cur_32, static_cast<int32_t>(mask));
+            s.write(cur_32, 4);
+        }
+    }
 }
 
-uint8_t ColorValueToInt(double value) {
-    const double max_uint8_size = 255.0;
-    return static_cast<uint8_t>(value * max_uint8_size);
-}
-
-void WritePixels(const Image& image, std::ofstream& s) {
-    int32_t padding = ((4 - static_cast<int32_t>(image.Width()) * 3) % 4) & 3;  // NOLINT
-    for (int32_t x = (static_cast<int32_t>(image.Height()) - 1); x >= 0; --x) {
-        for (int32_t y = 0; y <= (static_cast<int32_t>(image.Width()) - 1); ++y) {
-            Pixel cur_pixel = image.At(x, y);
-            uint8_t blue = ColorValueToInt(cur_pixel.blue);
-            uint8_t green = ColorValueToInt(cur_pixel.green);
-            uint8_t red = ColorValueToInt(cur_pixel.red);
-            char bgr[3] = {static_cast<char>(blue), static_cast<char>(green), static_cast<char>(red)};
-            s.write(bgr, 3);
+// Reads image rows [first_row, first_row + dst.Height()) into dst. Rows of a bottom-up file
+// are stored in reverse, so there the last requested row comes first.
+void ReadPixels(std::ifstream& s, const BMPHeader& header, const BMPinfoheader& infoheader, Image& dst,
+                size_t first_row) {
+    const size_t width = infoheader.width;
+    const size_t bytes_per_pixel = infoheader.depth / 8;
+    const bool top_down = infoheader.height < 0;
+    int64_t stride = RowStride(infoheader.width, infoheader.depth);
+    int64_t padding = stride - static_cast<int64_t>(width * bytes_per_pixel);
+    size_t first_file_row = top_down ? first_row : ImageHeight(infoheader) - first_row - dst.Height();
+    s.seekg(header.offset + static_cast<int64_t>(first_file_row) * stride);
+    std::vector<uint8_t> row(width * bytes_per_pixel);
+    const Kernels& kernels = GetKernels();
+    for (size_t i = 0; i < dst.Height(); i++) {
+        size_t x = top_down ? i : dst.Height() - 1 - i;
+        FileReadBytes(reinterpret_cast<char*>(row.data()), s, static_cast<std::streamsize>(row.size()));
+        if (bytes_per_pixel == 4) {
+            kernels.decode_bgra(row.data(), dst.Row(x), dst.AlphaRow(x), width);
+        } else {
+            kernels.decode_bgr(row.data(), dst.Row(x), width);
+        }
+        if (padding != 0) {
+            s.ignore(padding);
         }
+    }
+}
+
+// Same as ReadPixels, but every scale x scale block of the file becomes one averaged pixel of dst.
+// Blocks on the right and bottom edges may be smaller. Sums are kept in bytes, so only one
+// conversion to double is done per block.
+void ReadPixelsScaled(std::ifstream& s, const BMPHeader& header, const BMPinfoheader& infoheader, Image& dst,
+                      size_t first_row, size_t scale) {
+    const double max_uint8_size = 255.0;
+    const size_t width = infoheader.width;
+    const size_t height = ImageHeight(infoheader);
+    const size_t channels = infoheader.depth / 8;
+    const bool top_down = infoheader.height < 0;
+    int64_t stride = RowStride(infoheader.width, infoheader.depth);
+    int64_t padding = stride - static_cast<int64_t>(width * channels);
+    size_t first_image_row = first_row * scale;
+    size_t end_image_row = std::min((first_row + dst.Height()) * scale, height);
+    size_t first_file_row = top_down ? first_image_row : height - end_image_row;
+    s.seekg(header.offset + static_cast<int64_t>(first_file_row) * stride);
+    std::vector<uint8_t> row(width * channels);
+    std::vector<uint64_t> sums(dst.Width() * channels, 0);
+    for (size_t i = 0; i < end_image_row - first_image_row; i++) {
+        size_t image_row = top_down ? first_image_row + i : end_image_row - 1 - i;
+        FileReadBytes(reinterpret_cast<char*>(row.data()), s, static_cast<std::streamsize>(row.size()));
         if (padding != 0) {
-            char pad[3] = {0, 0, 0};
-            s.write(pad, padding);
+            s.ignore(padding);
+        }
+        for (size_t block = 0; block < dst.Width(); block++) {
+            for (size_t w = block * scale; w < std::min((block + 1) * scale, width); w++) {
+                for (size_t channel = 0; channel < channels; channel++) {
+                    sums[channels * block + channel] += row[channels * w + channel];
+                }
+            }
+        }
+        bool block_done = top_down ? image_row + 1 == end_image_row || (image_row + 1) % scale == 0
+                                   : image_row % scale == 0;
+        if (!block_done) {  // the block continues on the next row of the file
+            continue;
+        }
+        size_t block_row = image_row / scale;
+        size_t block_height = std::min((block_row + 1) * scale, height) - block_row * scale;
+        Pixel* dst_row = dst.Row(block_row - first_row);
+        for (size_t block = 0; block < dst.Width(); block++) {
+            size_t block_width = std::min((block + 1) * scale, width) - block * scale;
+            size_t count = block_width * block_height;
+            double divider = static_cast<double>(count) * max_uint8_size;
+            dst_row[block] = Pixel{static_cast<double>(sums[channels * block + 2]) / divider,
+                                   static_cast<double>(sums[channels * block + 1]) / divider,
+                                   static_cast<double>(sums[channels * block]) / divider};
+            if (channels == 4) {
+                dst.AlphaRow(block_row - first_row)[block] = static_cast<uint8_t>(sums[channels * block + 3] / count);
+            }
+        }
+        std::fill(sums.begin(), sums.end(), 0);
+    }
+}
+
+// Writes image rows [first_row, first_row + rows) in file order
+void WritePixels(const Image& image, size_t first_row, size_t rows, const BMPLayout& layout, std::ofstream& s) {
+    std::vector<uint8_t> row(RowStride(static_cast<int32_t>(image.Width()), layout.depth), 0);
+    const Kernels& kernels = GetKernels();
+    for (size_t i = 0; i < rows; i++) {
+        size_t x = layout.top_down ? first_row + i : first_row + rows - 1 - i;
+        if (layout.depth == bgra_depth) {
+            kernels.encode_bgra(image.Row(x), image.HasAlpha() ? image.AlphaRow(x) : nullptr, row.data(),
+                                image.Width());
+        } else {
+            kernels.encode_bgr(image.Row(x), row.data(), image.Width());
         }
+        s.write(reinterpret_cast<char*>(row.data()), static_cast<std::streamsize>(row.size()));
     }
 }
 
@@ -225,35 +377,66 @@ void CheckOpened(std::ofstream& output_file) {
 }
 }  // namespace
 
-Image ReadBMP(std::string& path) {
+ImageSize ReadBMPSize(std::string& path, size_t scale) {
     std::ifstream input_file(path, std::ios::in | std::ios::binary);
     CheckOpened(input_file);
-    BMPHeader header = ReadBMPHeader(input_file);
-    CheckBmpHeadervalid(header);
-    BMPinfoheader infoheader = ReadBMPinfoheader(input_file);
-    CheckBmpInfoHeadervalid(infoheader);
-    Image result = Image(infoheader.width, infoheader.height);
-    int32_t padding = ((4 - infoheader.width * 3) % 4) & 3;  // NOLINT
-    for (int32_t x = (infoheader.height - 1); x >= 0; --x) {
-        for (int32_t y = 0; y <= (infoheader.width - 1); ++y) {
-            Pixel pixel = ReadBmpPixel(input_file);
-            result.Put(x, y, pixel);
-        }
-        if (padding != 0) {
-            input_file.ignore(padding);
-        }
-    }
+    BMPHeader header;
+    BMPinfoheader infoheader;
+    ReadHeaders(input_file, header, infoheader);
+    input_file.close();
+    return ImageSize{ScaledLength(infoheader.width, scale), ScaledLength(ImageHeight(infoheader), scale)};
+}
 
+BMPLayout ReadBMPLayout(std::string& path) {
+    std::ifstream input_file(path, std::ios::in | std::ios::binary);
+    CheckOpened(input_file);
+    BMPHeader header;
+    BMPinfoheader infoheader;
+    BMPbitfields bitfields = ReadHeaders(input_file, header, infoheader);
+    input_file.close();
+    return BMPLayout{infoheader.depth, infoheader.compression, infoheader.height < 0, bitfields.alpha != 0};
+}
+
+Image ReadBMPRows(std::string& path, size_t first_row, size_t rows, size_t scale) {
+    std::ifstream input_file(path, std::ios::in | std::ios::binary);
+    CheckOpened(input_file);
+    BMPHeader header;
+    BMPinfoheader infoheader;
+    ReadHeaders(input_file, header, infoheader);
+    if (first_row + rows > ScaledLength(ImageHeight(infoheader), scale)) {
+        throw std::invalid_argument("Requested rows are out of input BMP");
+    }
+    Image result = Image(ScaledLength(infoheader.width, scale), rows);
+    if (infoheader.depth == bgra_depth) {
+        result.AddAlpha();
+    }
+    if (scale == 1) {
+        ReadPixels(input_file, header, infoheader, result, first_row);
+    } else {
+        ReadPixelsScaled(input_file, header, infoheader, result, first_row, scale);
+    }
     input_file.close();
     return result;
 }
 
-void WriteBMP(const Image& image, std::string& path) {
+void WriteBMP(const Image& image, std::string& path, const BMPLayout& layout) {
+    ImageSize size = {image.Width(), image.Height()};
+    WriteBMPHeaders(size, path, layout);
+    AppendBMPRows(image, 0, image.Height(), path, layout);
+}
+
+void WriteBMPHeaders(ImageSize size, std::string& path, const BMPLayout& layout) {
     std::ofstream output_file(path, std::ios::out | std::ios::binary);
     CheckOpened(output_file);
-    BMPHeader header = GenerateBmpHeader(image);
-    BMPinfoheader infoheader = GenerateBmpInfoHeader(image);
+    BMPHeader header = GenerateBmpHeader(size, layout);
+    BMPinfoheader infoheader = GenerateBmpInfoHeader(size, layout);
     WriteHeaders(header, infoheader, output_file);
-    WritePixels(image, output_file);
     output_file.close();
-}
\ No newline at end of file
+}
+
+void AppendBMPRows(const Image& image, size_t first_row, size_t rows, std::string& path, const BMPLayout& layout) {
+    std::ofstream output_file(path, std::ios::out | std::ios::binary | std::ios::app);
+    CheckOpened(output_file);
+    WritePixels(image, first_row, rows, layout, output_file);
+    output_file.close();
+}
@@ -1,4 +1,6 @@
 #include "Filters.h"
+#include "Kernels.h"
+#include "Workers.h"
 #include <stdexcept>
 #include <cctype>
 #include <algorithm>
@@ -48,12 +50,20 @@ size_t GetIndexWithOffset(size_t index, int offset, size_t min, size_t max) {
     return index + offset;
 }
 
-const Pixel& GetPixelByOffsetWidth(size_t h, size_t w, int offset, const Image& img) {
-    return img.At(h, GetIndexWithOffset(w, offset, 0, img.Width() - 1));
-}
+using StencilRowKernel = std::function<void(const Pixel*, const Pixel*, const Pixel*, Pixel*, size_t)>;
 
-const Pixel& GetPixelByOffsetHeight(size_t h, size_t w, int offset, const Image& img) {
-    return img.At(GetIndexWithOffset(h, offset, 0, img.Height() - 1), w);
+// Runs a 3 row stencil over img, rows out of the image are clamped to the border ones
+Image ApplyStencil(const Image& img, const StencilRowKernel& row_kernel) {
+    Image result = Image(img.Width(), img.Height());
+    ForEachBand(img.Height(), [&](size_t begin, size_t end) {
+        for (size_t h = begin; h < end; h++) {
+            const Pixel* up_row = img.Row(GetIndexWithOffset(h, -1, 0, img.Height() - 1));
+            const Pixel* down_row = img.Row(GetIndexWithOffset(h, 1, 0, img.Height() - 1));
+            row_kernel(up_row, img.Row(h), down_row, result.Row(h), img.Width());
+        }
+    });
+    result.CopyAlpha(img);
+    return result;
 }
 }  // namespace
 
@@ -62,15 +72,24 @@ Crop::Crop(size_t width, size_t height) : width_(width), height_(height) {
 
 Image Crop::Apply(const Image& img) {
     Image result = Image(std::min(width_, img.Width()), std::min(height_, img.Height()));
-    for (size_t h = 0; h < std::min(height_, img.Height()); h++) {
-        for (size_t w = 0; w < std::min(width_, img.Width()); w++) {
-            const Pixel& cur_pixel = img.At(h, w);
-            result.Put(h, w, cur_pixel);
+    ForEachBand(result.Height(), [&img, &result](size_t begin, size_t end) {
+        for (size_t h = begin; h < end; h++) {
+            std::copy(img.Row(h), img.Row(h) + result.Width(), result.Row(h));
         }
-    }
+    });
+    result.CopyAlpha(img);
     return result;
 }
 
+ImageSize Crop::OutputSize(ImageSize input) const {
+    return ImageSize{std::min(width_, input.width), std::min(height_, input.height)};
+}
+
+void Crop::Downscale(size_t scale) {
+    width_ = ScaledLength(width_, scale);
+    height_ = ScaledLength(height_, scale);
+}
+
 std::unique_ptr<Filter> CreateCrop(const std::vector<std::string>& params) {
     if (params.size() != 2) {
         throw std::invalid_argument("Incorrect number of arguments for Crop filter");
@@ -85,19 +104,14 @@ std::unique_ptr<Filter> CreateCrop(const std::vector<std::string>& params) {
 }
 
 Image Grayscale::Apply(const Image& img) {
-    const double red_pixel_weight = 0.299;
-    const double green_pixel_weight = 0.587;
-    const double blue_pixel_weight = 0.114;
     Image result = Image(img.Width(), img.Height());
-    for (size_t h = 0; h < img.Height(); h++) {
-        for (size_t w = 0; w < img.Width(); w++) {
-            const Pixel& cur_pixel = img.At(h, w);
-            double graycolor = red_pixel_weight * cur_pixel.red + green_pixel_weight * cur_pixel.green +
-                               blue_pixel_weight * cur_pixel.blue;
-            Pixel put = {graycolor, graycolor, graycolor};
-            result.Put(h, w, put);
+    const Kernels& kernels = GetKernels();
+    ForEachBand(img.Height(), [&](size_t begin, size_t end) {
+        for (size_t h = begin; h < end; h++) {
+            kernels.grayscale(img.Row(h), result.Row(h), img.Width());
         }
-    }
+    });
+    result.CopyAlpha(img);
     return result;
 }
 
@@ -110,13 +124,13 @@ std::unique_ptr<Filter> CreateGrayscale(const std::vector<std::string>& params)
 
 Image Negative::Apply(const Image& img) {
     Image result = Image(img.Width(), img.Height());
-    for (size_t h = 0; h < img.Height(); h++) {
-        for (size_t w = 0; w < img.Width(); w++) {
-            const Pixel& cur_pixel = img.At(h, w);
-            Pixel put = {1.0 - cur_pixel.red, 1.0 - cur_pixel.green, 1.0 - cur_pixel.blue};
-            result.Put(h, w, put);
+    const Kernels& kernels = GetKernels();
+    ForEachBand(img.Height(), [&](size_t begin, size_t end) {
+        for (size_t h = begin; h < end; h++) {
+            kernels.negative(img.Row(h), result.Row(h), img.Width());
         }
-    }
+    });
+    result.CopyAlpha(img);
     return result;
 }
 
@@ -131,32 +145,22 @@ Matrix::Matrix(std::vector<double> weights) : weights_(weights) {
 }
 
 Image Matrix::Apply(const Image& img) {
-    Image result = Image(img.Width(), img.Height());
-    for (size_t h = 0; h < img.Height(); h++) {
-        for (size_t w = 0; w < img.Width(); w++) {
-            const Pixel& left_pixel = GetPixelByOffsetWidth(h, w, -1, img);
-            const Pixel& right_pixel = GetPixelByOffsetWidth(h, w, 1, img);
-            const Pixel& up_pixel = GetPixelByOffsetHeight(h, w, -1, img);
-            const Pixel& down_pixel = GetPixelByOffsetHeight(h, w, 1, img);
-            const Pixel& cur_pixel = img.At(h, w);
-            Pixel put;
-            put.red = weights_[2] * cur_pixel.red + weights_[0] * left_pixel.red + weights_[1] * right_pixel.red +
-                      weights_[3] * up_pixel.red + weights_[4] * down_pixel.red;
-            put.green = weights_[2] * cur_pixel.green + weights_[0] * left_pixel.green +
-                        weights_[1] * right_pixel.green + weights_[3] * up_pixel.green + weights_[4] * down_pixel.green;
-            put.blue = weights_[2] * cur_pixel.blue + weights_[0] * left_pixel.blue + weights_[1] * right_pixel.blue +
-                       weights_[3] * up_pixel.blue + weights_[4] * down_pixel.blue;
-
-            result.Put(h, w, put);
-        }
-    }
-    return result;
+    const Kernels& kernels = GetKernels();
+    return ApplyStencil(img, [&](const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width) {
+        kernels.stencil(up, cur, down, dst, width, weights_.data());
+    });
+}
+
+size_t Matrix::Halo() const {
+    return 1;
 }
 
 Image Sharpening::Apply(const Image& img) {
-    Matrix matrix_filter = Matrix({-1, -1, 5, -1, -1});  // NOLINT
-    Image result = matrix_filter.Apply(img);
-    return result;
+    return ApplyStencil(img, GetKernels().sharpening);
+}
+
+size_t Sharpening::Halo() const {
+    return 1;
 }
 
 std::unique_ptr<Filter> CreateSharpening(const std::vector<std::string>& params) {
@@ -170,22 +174,21 @@ EdgeDetection::EdgeDetection(double threshold) : threshold_(threshold) {
 }
 
 Image EdgeDetection::Apply(const Image& img) {
-    Image grayscale_image = Grayscale().Apply(img);
-    Matrix matrix_filter = Matrix({-1, -1, 4, -1, -1});  // NOLINT
-    Image result = matrix_filter.Apply(grayscale_image);
-    Pixel black = {0, 0, 0};
-    Pixel white = {1, 1, 1};
-    for (size_t h = 0; h < img.Height(); h++) {
-        for (size_t w = 0; w < img.Width(); w++) {
-            const Pixel& cur_pixel = result.At(h, w);
-            if (cur_pixel.red > threshold_) {
-                result.Put(h, w, white);
-            } else {
-                result.Put(h, w, black);
-            }
-        }
-    }
-    return result;
+    const Kernels& kernels = GetKernels();
+    // threshold every row right after the stencil, while it is in cache
+    return ApplyStencil(Grayscale().Apply(img),
+                        [&](const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width) {
+                            kernels.edge_detection(up, cur, down, dst, width);
+                            kernels.threshold(dst, dst, width, threshold_);
+                        });
+}
+
+size_t EdgeDetection::Halo() const {
+    return 1;
+}
+
+size_t EdgeDetection::ScratchFrames() const {
+    return 1;  // grayscale copy of the input
 }
 
 std::unique_ptr<Filter> CreateEdgeDetection(const std::vector<std::string>& params) {
@@ -199,8 +202,12 @@ std::unique_ptr<Filter> CreateEdgeDetection(const std::vector<std::string>& para
 }
 
 GaussianBlur::GaussianBlur(double sigma) : sigma_(sigma) {
+    CalculateWeights(3 * static_cast<int>(sigma_));
+}
+
+void GaussianBlur::CalculateWeights(int delta) {
     double weights_sum = 0;
-    delta_ = 3 * static_cast<int>(sigma_);
+    delta_ = delta;
     dist_weight_.resize(delta_ + 1);
     for (int distance = 0; distance <= delta_; distance++) {  // calculate weights for distance
         double weight = (1 / sigma_ * std::sqrt(2 * std::numbers::pi)) *
@@ -220,39 +227,40 @@ GaussianBlur::GaussianBlur(double sigma) : sigma_(sigma) {
 Image GaussianBlur::Apply(const Image& img) {
     Image result = Image(img.Width(), img.Height());
     Image x_gauss = Image(img.Width(), img.Height());
-    for (size_t h = 0; h < img.Height(); h++) {  // calculate gauss function for x only
-        for (size_t w = 0; w < img.Width(); w++) {
-            double red = 0;
-            double green = 0;
-            double blue = 0;
-            for (int offset_w = -delta_; offset_w <= delta_; offset_w++) {
-                const Pixel& temp = GetPixelByOffsetWidth(h, w, offset_w, img);
-                red += temp.red * dist_weight_[std::abs(offset_w)];
-                green += temp.green * dist_weight_[std::abs(offset_w)];
-                blue += temp.blue * dist_weight_[std::abs(offset_w)];
-            }
-            Pixel cur_pixel = Pixel{red, green, blue};
-            x_gauss.Put(h, w, cur_pixel);
+    const Kernels& kernels = GetKernels();
+    ForEachBand(img.Height(), [&](size_t begin, size_t end) {  // calculate gauss function for x only
+        for (size_t h = begin; h < end; h++) {
+            kernels.blur_row(img.Row(h), x_gauss.Row(h), img.Width(), dist_weight_.data(), delta_);
         }
-    }
-    for (size_t h = 0; h < img.Height(); h++) {  // calculate result
-        for (size_t w = 0; w < img.Width(); w++) {
-            double red = 0;
-            double green = 0;
-            double blue = 0;
+    });
+    ForEachBand(img.Height(), [&](size_t begin, size_t end) {  // calculate result
+        std::vector<const Pixel*> rows(2 * delta_ + 1);
+        for (size_t h = begin; h < end; h++) {
             for (int offset_h = -delta_; offset_h <= delta_; offset_h++) {
-                const Pixel& temp = GetPixelByOffsetHeight(h, w, offset_h, x_gauss);
-                red += temp.red * dist_weight_[std::abs(offset_h)];
-                green += temp.green * dist_weight_[std::abs(offset_h)];
-                blue += temp.blue * dist_weight_[std::abs(offset_h)];
+                rows[offset_h + delta_] = x_gauss.Row(GetIndexWithOffset(h, offset_h, 0, img.Height() - 1));
             }
-            Pixel cur_pixel = Pixel{red, green, blue};
-            result.Put(h, w, cur_pixel);
+            kernels.blur_column(rows.data(), result.Row(h), img.Width(), dist_weight_.data(), delta_);
         }
-    }
+    });
+    result.CopyAlpha(img);
     return result;
 }
 
+size_t GaussianBlur::Halo() const {
+    return delta_;
+}
+
+size_t GaussianBlur::ScratchFrames() const {
+    return 1;  // result of the horizontal pass
+}
+
+// The proxy radius is the full radius scaled up to whole pixels, not 3 * sigma_ of the proxy:
+// once sigma_ drops below 1 that would be 0 and the proxy would lose the blur.
+void GaussianBlur::Downscale(size_t scale) {
+    sigma_ /= static_cast<double>(scale);
+    CalculateWeights(static_cast<int>(ScaledLength(delta_, scale)));
+}
+
 std::unique_ptr<Filter> CreateGaussianBlur(const std::vector<std::string>& params) {
     if (params.size() != 1) {
         throw std::invalid_argument("Incorrect number of arguments for Gaussian Blur filter");
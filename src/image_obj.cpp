@@ -1,11 +1,19 @@
 #include "Image.h"
+#include "Workers.h"
 #include <algorithm>
 
+size_t ScaledLength(size_t length, size_t scale) {
+    return length / scale + (length % scale != 0 ? 1 : 0);
+}
+
 Image::Image(size_t width, size_t height) {
     Pixel white = Pixel{1, 1, 1};
     width_ = width;
     height_ = height;
-    pixels_.resize(width * height, white);
+    pixels_.resize(width * height);
+    ForEachBand(height, [this, white](size_t begin, size_t end) {
+        std::fill(pixels_.begin() + begin * width_, pixels_.begin() + end * width_, white);
+    });
 }
 
 const Pixel& Image::At(size_t x, size_t y) const {
@@ -17,10 +25,51 @@ void Image::Put(size_t x, size_t y, const Pixel& pixel) {
         Pixel{std::clamp(pixel.red, 0.0, 1.0), std::clamp(pixel.green, 0.0, 1.0), std::clamp(pixel.blue, 0.0, 1.0)};
 }
 
+const Pixel* Image::Row(size_t x) const {
+    return pixels_.data() + x * width_;
+}
+
+Pixel* Image::Row(size_t x) {
+    return pixels_.data() + x * width_;
+}
+
 size_t Image::Width() const {
     return width_;
 }
 
 size_t Image::Height() const {
     return height_;
+}
+
+bool Image::HasAlpha() const {
+    return !alpha_.empty();
+}
+
+void Image::AddAlpha() {
+    const uint8_t opaque = 255;
+    alpha_.resize(width_ * height_);
+    ForEachBand(height_, [this, opaque](size_t begin, size_t end) {
+        std::fill(alpha_.begin() + begin * width_, alpha_.begin() + end * width_, opaque);
+    });
+}
+
+const uint8_t* Image::AlphaRow(size_t x) const {
+    return alpha_.data() + x * width_;
+}
+
+uint8_t* Image::AlphaRow(size_t x) {
+    return alpha_.data() + x * width_;
+}
+
+void Image::CopyAlpha(const Image& other) {
+    if (!other.HasAlpha()) {
+        alpha_.clear();
+        return;
+    }
+    alpha_.resize(width_ * height_);
+    ForEachBand(height_, [this, &other](size_t begin, size_t end) {
+        for (size_t x = begin; x < end; x++) {
+            std::copy(other.AlphaRow(x), other.AlphaRow(x) + width_, AlphaRow(x));
+        }
+    });
 }
\ No newline at end of file
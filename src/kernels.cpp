@@ -0,0 +1,326 @@
+#include "Kernels.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_PROCESSOR_X86_DISPATCH
+#define KERNEL_INLINE [[gnu::always_inline]] inline
+#else
+#define KERNEL_INLINE inline
+#endif
+
+namespace {
+const double max_uint8_size = 255.0;
+
+// Kernel bodies are written once and force inlined into every ISA variant below,
+// so the compiler vectorizes each copy for its own target.
+KERNEL_INLINE double ClampColor(double value) {
+    return std::clamp(value, 0.0, 1.0);
+}
+
+KERNEL_INLINE void DecodeBgrImpl(const uint8_t* src, Pixel* dst, size_t width) {
+    for (size_t w = 0; w < width; w++) {
+        dst[w].blue = static_cast<double>(src[3 * w]) / max_uint8_size;
+        dst[w].green = static_cast<double>(src[3 * w + 1]) / max_uint8_size;
+        dst[w].red = static_cast<double>(src[3 * w + 2]) / max_uint8_size;
+    }
+}
+
+KERNEL_INLINE void EncodeBgrImpl(const Pixel* src, uint8_t* dst, size_t width) {
+    for (size_t w = 0; w < width; w++) {
+        dst[3 * w] = static_cast<uint8_t>(src[w].blue * max_uint8_size);
+        dst[3 * w + 1] = static_cast<uint8_t>(src[w].green * max_uint8_size);
+        dst[3 * w + 2] = static_cast<uint8_t>(src[w].red * max_uint8_size);
+    }
+}
+
+KERNEL_INLINE void DecodeBgraImpl(const uint8_t* src, Pixel* dst, uint8_t* alpha, size_t width) {
+    for (size_t w = 0; w < width; w++) {
+        dst[w].blue = static_cast<double>(src[4 * w]) / max_uint8_size;
+        dst[w].green = static_cast<double>(src[4 * w + 1]) / max_uint8_size;
+        dst[w].red = static_cast<double>(src[4 * w + 2]) / max_uint8_size;
+        alpha[w] = src[4 * w + 3];
+    }
+}
+
+KERNEL_INLINE void EncodeBgraImpl(const Pixel* src, const uint8_t* alpha, uint8_t* dst, size_t width) {
+    const uint8_t opaque = 255;
+    for (size_t w = 0; w < width; w++) {
+        dst[4 * w] = static_cast<uint8_t>(src[w].blue * max_uint8_size);
+        dst[4 * w + 1] = static_cast<uint8_t>(src[w].green * max_uint8_size);
+        dst[4 * w + 2] = static_cast<uint8_t>(src[w].red * max_uint8_size);
+        dst[4 * w + 3] = alpha != nullptr ? alpha[w] : opaque;
+    }
+}
+
+KERNEL_INLINE void GrayscaleImpl(const Pixel* src, Pixel* dst, size_t width) {
+    const double red_pixel_weight = 0.299;
+    const double green_pixel_weight = 0.587;
+    const double blue_pixel_weight = 0.114;
+    for (size_t w = 0; w < width; w++) {
+        double graycolor = ClampColor(red_pixel_weight * src[w].red + green_pixel_weight * src[w].green +
+                                      blue_pixel_weight * src[w].blue);
+        dst[w] = Pixel{graycolor, graycolor, graycolor};
+    }
+}
+
+KERNEL_INLINE void NegativeImpl(const Pixel* src, Pixel* dst, size_t width) {
+    for (size_t w = 0; w < width; w++) {
+        dst[w] = Pixel{ClampColor(1.0 - src[w].red), ClampColor(1.0 - src[w].green), ClampColor(1.0 - src[w].blue)};
+    }
+}
+
+KERNEL_INLINE void ThresholdImpl(const Pixel* src, Pixel* dst, size_t width, double threshold) {
+    for (size_t w = 0; w < width; w++) {
+        double color = src[w].red > threshold ? 1.0 : 0.0;
+        dst[w] = Pixel{color, color, color};
+    }
+}
+
+KERNEL_INLINE double StencilValue(double left, double right, double cur, double up, double down,
+                                  const double (&weights)[5]) {
+    return weights[2] * cur + weights[0] * left + weights[1] * right + weights[3] * up + weights[4] * down;
+}
+
+KERNEL_INLINE Pixel StencilPixel(const Pixel& left, const Pixel& right, const Pixel& cur, const Pixel& up,
+                                 const Pixel& down, const double (&weights)[5]) {
+    return Pixel{ClampColor(StencilValue(left.red, right.red, cur.red, up.red, down.red, weights)),
+                 ClampColor(StencilValue(left.green, right.green, cur.green, up.green, down.green, weights)),
+                 ClampColor(StencilValue(left.blue, right.blue, cur.blue, up.blue, down.blue, weights))};
+}
+
+// The first and the last pixels of the row clamp their neighbours, the interior loop has no branches
+KERNEL_INLINE void StencilRowImpl(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width,
+                                  const double (&weights)[5]) {
+    if (width == 0) {
+        return;
+    }
+    const size_t last = width - 1;
+    dst[0] = StencilPixel(cur[0], cur[std::min<size_t>(1, last)], cur[0], up[0], down[0], weights);
+    for (size_t w = 1; w < last; w++) {
+        dst[w] = StencilPixel(cur[w - 1], cur[w + 1], cur[w], up[w], down[w], weights);
+    }
+    if (last > 0) {
+        dst[last] = StencilPixel(cur[last - 1], cur[last], cur[last], up[last], down[last], weights);
+    }
+}
+
+KERNEL_INLINE void StencilImpl(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width,
+                               const double* weights_ptr) {
+    const double weights[5] = {weights_ptr[0], weights_ptr[1], weights_ptr[2], weights_ptr[3], weights_ptr[4]};
+    StencilRowImpl(up, cur, down, dst, width, weights);
+}
+
+constexpr double sharpening_weights[5] = {-1, -1, 5, -1, -1};
+constexpr double edge_detection_weights[5] = {-1, -1, 4, -1, -1};
+
+// Weights are known at compile time, so multiplications by -1 fold into subtractions and the
+// loop unrolls and vectorizes without loading weights. Operation order is the same as in the
+// generic stencil, so results are bit identical to Matrix with the same weights.
+template <const double (&Weights)[5]>
+KERNEL_INLINE void FixedStencilImpl(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width) {
+    StencilRowImpl(up, cur, down, dst, width, Weights);
+}
+
+KERNEL_INLINE Pixel BlurBorderPixel(const Pixel* src, size_t w, size_t last, const double* dist_weight, int delta) {
+    double red = 0;
+    double green = 0;
+    double blue = 0;
+    for (int offset = -delta; offset <= delta; offset++) {
+        int64_t index =
+            std::clamp(static_cast<int64_t>(w) + offset, static_cast<int64_t>(0), static_cast<int64_t>(last));
+        const Pixel& temp = src[index];
+        red += temp.red * dist_weight[std::abs(offset)];
+        green += temp.green * dist_weight[std::abs(offset)];
+        blue += temp.blue * dist_weight[std::abs(offset)];
+    }
+    return Pixel{ClampColor(red), ClampColor(green), ClampColor(blue)};
+}
+
+KERNEL_INLINE void BlurRowImpl(const Pixel* src, Pixel* dst, size_t width, const double* dist_weight, int delta) {
+    if (width == 0) {
+        return;
+    }
+    const size_t last = width - 1;
+    const size_t border = std::min(static_cast<size_t>(delta), width);
+    const size_t interior_end = width > border ? width - border : border;
+    for (size_t w = 0; w < border; w++) {
+        dst[w] = BlurBorderPixel(src, w, last, dist_weight, delta);
+    }
+    for (size_t w = border; w < interior_end; w++) {  // interior, every tap is inside the row
+        double red = 0;
+        double green = 0;
+        double blue = 0;
+        for (int offset = -delta; offset <= delta; offset++) {
+            const Pixel& temp = src[w + offset];
+            red += temp.red * dist_weight[std::abs(offset)];
+            green += temp.green * dist_weight[std::abs(offset)];
+            blue += temp.blue * dist_weight[std::abs(offset)];
+        }
+        dst[w] = Pixel{ClampColor(red), ClampColor(green), ClampColor(blue)};
+    }
+    for (size_t w = std::max(border, interior_end); w < width; w++) {
+        dst[w] = BlurBorderPixel(src, w, last, dist_weight, delta);
+    }
+}
+
+KERNEL_INLINE void BlurColumnImpl(const Pixel* const* rows, Pixel* dst, size_t width, const double* dist_weight,
+                                  int delta) {
+    std::fill(dst, dst + width, Pixel{0, 0, 0});
+    for (int offset = -delta; offset <= delta; offset++) {  // accumulate whole rows, contiguous in memory
+        const Pixel* src = rows[offset + delta];
+        const double weight = dist_weight[std::abs(offset)];
+        for (size_t w = 0; w < width; w++) {
+            dst[w].red += src[w].red * weight;
+            dst[w].green += src[w].green * weight;
+            dst[w].blue += src[w].blue * weight;
+        }
+    }
+    for (size_t w = 0; w < width; w++) {
+        dst[w] = Pixel{ClampColor(dst[w].red), ClampColor(dst[w].green), ClampColor(dst[w].blue)};
+    }
+}
+}  // namespace
+
+#define DEFINE_KERNEL_VARIANT(NAMESPACE, TARGET)                                                                    \
+    namespace NAMESPACE {                                                                                           \
+    TARGET void DecodeBgr(const uint8_t* src, Pixel* dst, size_t width) {                                           \
+        DecodeBgrImpl(src, dst, width);                                                                             \
+    }                                                                                                               \
+    TARGET void EncodeBgr(const Pixel* src, uint8_t* dst, size_t width) {                                           \
+        EncodeBgrImpl(src, dst, width);                                                                             \
+    }                                                                                                               \
+    TARGET void DecodeBgra(const uint8_t* src, Pixel* dst, uint8_t* alpha, size_t width) {                          \
+        DecodeBgraImpl(src, dst, alpha, width);                                                                     \
+    }                                                                                                               \
+    TARGET void EncodeBgra(const Pixel* src, const uint8_t* alpha, uint8_t* dst, size_t width) {                    \
+        EncodeBgraImpl(src, alpha, dst, width);                                                                     \
+    }                                                                                                               \
+    TARGET void Grayscale(const Pixel* src, Pixel* dst, size_t width) {                                             \
+        GrayscaleImpl(src, dst, width);                                                                             \
+    }                                                                                                               \
+    TARGET void Negative(const Pixel* src, Pixel* dst, size_t width) {                                              \
+        NegativeImpl(src, dst, width);                                                                              \
+    }                                                                                                               \
+    TARGET void Threshold(const Pixel* src, Pixel* dst, size_t width, double threshold) {                           \
+        ThresholdImpl(src, dst, width, threshold);                                                                  \
+    }                                                                                                               \
+    TARGET void Stencil(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width,             \
+                        const double* weights) {                                                                    \
+        StencilImpl(up, cur, down, dst, width, weights);                                                            \
+    }                                                                                                               \
+    TARGET void Sharpening(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width) {        \
+        FixedStencilImpl<sharpening_weights>(up, cur, down, dst, width);                                            \
+    }                                                                                                               \
+    TARGET void EdgeDetection(const Pixel* up, const Pixel* cur, const Pixel* down, Pixel* dst, size_t width) {     \
+        FixedStencilImpl<edge_detection_weights>(up, cur, down, dst, width);                                        \
+    }                                                                                                               \
+    TARGET void BlurRow(const Pixel* src, Pixel* dst, size_t width, const double* dist_weight, int delta) {         \
+        BlurRowImpl(src, dst, width, dist_weight, delta);                                                           \
+    }                                                                                                               \
+    TARGET void BlurColumn(const Pixel* const* rows, Pixel* dst, size_t width, const double* dist_weight,           \
+                           int delta) {                                                                             \
+        BlurColumnImpl(rows, dst, width, dist_weight, delta);                                                       \
+    }                                                                                                               \
+    const Kernels table = {DecodeBgr, EncodeBgr, DecodeBgra, EncodeBgra,    Grayscale, Negative,                   \
+                           Threshold, Stencil,   Sharpening, EdgeDetection, BlurRow,   BlurColumn};                 \
+    }  // namespace NAMESPACE
+
+namespace {
+DEFINE_KERNEL_VARIANT(generic, )
+#ifdef IMAGE_PROCESSOR_X86_DISPATCH
+DEFINE_KERNEL_VARIANT(sse4, __attribute__((target("sse4.2"))))
+// every variant has to produce the same bytes as the generic one, so this file is built
+// with -ffp-contract=off (see CMakeLists.txt): fused multiply-adds round differently
+DEFINE_KERNEL_VARIANT(avx2, __attribute__((target("avx2"))))
+DEFINE_KERNEL_VARIANT(avx512, __attribute__((target("avx512f,avx512dq,avx512bw,avx512vl"))))
+#endif
+
+const Kernels* current_kernels = nullptr;
+
+const Kernels& KernelsFor(Isa isa) {
+#ifdef IMAGE_PROCESSOR_X86_DISPATCH
+    switch (isa) {
+        case Isa::Avx512:
+            return avx512::table;
+        case Isa::Avx2:
+            return avx2::table;
+        case Isa::Sse4:
+            return sse4::table;
+        case Isa::Generic:
+            break;
+    }
+#endif
+    return generic::table;
+}
+}  // namespace
+
+bool IsaSupported(Isa isa) {
+#ifdef IMAGE_PROCESSOR_X86_DISPATCH
+    switch (isa) {
+        case Isa::Avx512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+                   __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+        case Isa::Avx2:
+            return __builtin_cpu_supports("avx2");
+        case Isa::Sse4:
+            return __builtin_cpu_supports("sse4.2");
+        case Isa::Generic:
+            return true;
+    }
+#endif
+    return isa == Isa::Generic;
+}
+
+Isa DetectIsa() {
+    for (Isa isa : {Isa::Avx512, Isa::Avx2, Isa::Sse4}) {
+        if (IsaSupported(isa)) {
+            return isa;
+        }
+    }
+    return Isa::Generic;
+}
+
+Isa ParseIsa(const std::string& name) {
+    if (name == "generic") {
+        return Isa::Generic;
+    } else if (name == "sse4") {
+        return Isa::Sse4;
+    } else if (name == "avx2") {
+        return Isa::Avx2;
+    } else if (name == "avx512") {
+        return Isa::Avx512;
+    } else if (name == "auto") {
+        return DetectIsa();
+    }
+    throw std::invalid_argument("Unknown isa " + name + ", expected auto, generic, sse4, avx2 or avx512");
+}
+
+std::string IsaName(Isa isa) {
+    switch (isa) {
+        case Isa::Avx512:
+            return "avx512";
+        case Isa::Avx2:
+            return "avx2";
+        case Isa::Sse4:
+            return "sse4";
+        case Isa::Generic:
+            break;
+    }
+    return "generic";
+}
+
+void SelectKernels(Isa isa) {
+    if (!IsaSupported(isa)) {
+        throw std::invalid_argument("This CPU doesnt support isa " + IsaName(isa));
+    }
+    current_kernels = &KernelsFor(isa);
+}
+
+const Kernels& GetKernels() {
+    if (current_kernels == nullptr) {
+        SelectKernels(DetectIsa());
+    }
+    return *current_kernels;
+}
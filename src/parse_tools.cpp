@@ -15,6 +15,25 @@ bool IsFilterName(std::string& s) {
     }
     return false;
 }
+bool IsOptionName(std::string& s) {
+    if (s.starts_with("--") && s.size() >= 3 && std::isalpha(s[2])) {
+        return true;
+    }
+    return false;
+}
+void ParseOption(const std::string& name, const std::string& value, Options& options) {
+    if (name == "isa") {
+        options.isa = value;
+    } else if (name == "max-memory") {
+        options.max_memory = value;
+    } else if (name == "preview") {
+        options.preview = value;
+    } else if (name == "threads") {
+        options.threads = value;
+    } else {
+        throw std::invalid_argument("Unknown option --" + name);
+    }
+}
 }  // namespace
 
 Args ParseArgs(int argc, char** argv) {
@@ -23,7 +42,12 @@ Args ParseArgs(int argc, char** argv) {
     FilterArgs cur_arg{"", {}};
     for (int i = 3; i < argc; i++) {
         std::string cur = argv[i];
-        if (IsFilterName(cur)) {
+        if (IsOptionName(cur)) {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Option " + cur + " without value");
+            }
+            ParseOption(cur.substr(2), argv[++i], result.options);
+        } else if (IsFilterName(cur)) {
             if (!cur_arg.name.empty()) {
                 result.args.push_back(cur_arg);
                 cur_arg.name = "";
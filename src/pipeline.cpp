@@ -0,0 +1,244 @@
+#include "Pipeline.h"
+#include "FileWorking.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+size_t FrameBytes(ImageSize size) {
+    return size.width * size.height * (sizeof(Pixel) + sizeof(uint8_t));  // with alpha plane of 32 bits images
+}
+
+size_t RowBufferBytes(ImageSize size) {
+    return size.width * 4;
+}
+
+ImageSize ChainOutputSize(ImageSize input, const FilterChain& chain) {
+    for (const std::unique_ptr<Filter>& filter : chain) {
+        input = filter->OutputSize(input);
+    }
+    return input;
+}
+
+size_t ChainHalo(const FilterChain& chain) {
+    size_t halo = 0;
+    for (const std::unique_ptr<Filter>& filter : chain) {
+        halo += filter->Halo();
+    }
+    return halo;
+}
+
+// Every filter keeps its input, its scratch frames and its result alive at once,
+// the previous frame is released only after Apply returns.
+size_t ChainPeakBytes(ImageSize input, const FilterChain& chain) {
+    size_t peak = FrameBytes(input) + RowBufferBytes(input);
+    ImageSize cur = input;
+    for (const std::unique_ptr<Filter>& filter : chain) {
+        ImageSize out = filter->OutputSize(cur);
+        peak = std::max(peak, FrameBytes(cur) * (1 + filter->ScratchFrames()) + FrameBytes(out));
+        cur = out;
+    }
+    return std::max(peak, FrameBytes(cur) + RowBufferBytes(cur));
+}
+
+size_t StripPeakBytes(ImageSize input, const FilterChain& chain, size_t strip_rows) {
+    size_t input_rows = std::min(strip_rows + 2 * ChainHalo(chain), input.height);
+    return ChainPeakBytes(ImageSize{input.width, input_rows}, chain);
+}
+
+// Frames are big enough to be mapped by malloc, but glibc raises its mmap threshold past the
+// size of a freed mapping, so later frames of that size stay in the heap after free and the
+// process keeps more than the planner counts. A fixed threshold turns off that adjustment.
+void KeepFramesMapped() {
+#ifdef __GLIBC__
+    const int mmap_threshold = 128 * 1024;
+    mallopt(M_MMAP_THRESHOLD, mmap_threshold);
+#endif
+}
+
+// memory taken before any frame: code, libraries, thread stacks. 0 when unknown
+size_t ResidentBytes() {
+    size_t resident = 0;
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    if (statm >> total_pages >> resident_pages) {
+        resident = resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return resident;
+}
+
+void RunWholeFrame(FilesPaths& files, const FilterChain& chain, size_t scale) {
+    Image image = ReadBMPRows(files.input, 0, ReadBMPSize(files.input, scale).height, scale);
+    for (const std::unique_ptr<Filter>& filter : chain) {
+        image = filter->Apply(image);
+    }
+    WriteBMP(image, files.output, ReadBMPLayout(files.input));
+}
+
+// Every strip is read together with Halo() rows of context on both sides, so rows spoiled
+// by clamping at the strip border never reach the output. Strips follow the row order of
+// the files: from the bottom of the image to the top, or from the top for top-down files.
+void WriteStrips(FilesPaths& files, std::string& output_path, const FilterChain& chain, size_t strip_rows,
+                 size_t scale) {
+    ImageSize input = ReadBMPSize(files.input, scale);
+    ImageSize output = ChainOutputSize(input, chain);
+    BMPLayout layout = ReadBMPLayout(files.input);
+    size_t halo = ChainHalo(chain);
+    WriteBMPHeaders(output, output_path, layout);
+    size_t strips = output.height / strip_rows + (output.height % strip_rows != 0 ? 1 : 0);
+    for (size_t strip_index = 0; strip_index < strips; strip_index++) {
+        size_t from_top = layout.top_down ? strip_index : strips - 1 - strip_index;
+        size_t begin = from_top * strip_rows;
+        size_t end = std::min(begin + strip_rows, output.height);
+        size_t top = begin > halo ? begin - halo : 0;
+        size_t bottom = std::min(end + halo, input.height);
+        Image strip = ReadBMPRows(files.input, top, bottom - top, scale);
+        ImageSize frame = input;
+        for (const std::unique_ptr<Filter>& filter : chain) {
+            strip = filter->Apply(strip);
+            frame = filter->OutputSize(frame);
+            if (strip.Width() > frame.width || top + strip.Height() > frame.height) {  // cut like the whole frame
+                strip = Crop(frame.width, frame.height - top).Apply(strip);
+            }
+        }
+        AppendBMPRows(strip, begin - top, end - begin, output_path, layout);
+    }
+}
+
+// The input is read until the last strip and may be the output itself, so strips go to a file
+// next to the output which replaces it only at the end. A failed job leaves the output untouched.
+void RunInStrips(FilesPaths& files, const FilterChain& chain, size_t strip_rows, size_t scale) {
+    std::string partial_path = files.output + ".part";
+    try {
+        WriteStrips(files, partial_path, chain, strip_rows, scale);
+        std::filesystem::rename(partial_path, files.output);
+    } catch (...) {
+        std::error_code ignored;
+        std::filesystem::remove(partial_path, ignored);
+        throw;
+    }
+}
+
+// false for empty strings, anything but digits and values which don't fit size_t
+bool ParseUnsigned(const std::string& s, size_t& result) {
+    auto [end, error] = std::from_chars(s.data(), s.data() + s.size(), result);
+    return !s.empty() && error == std::errc() && end == s.data() + s.size();
+}
+
+size_t ParsePositiveOption(const std::string& s, const std::string& name) {
+    size_t result = 0;
+    if (!ParseUnsigned(s, result) || result == 0) {
+        throw std::invalid_argument("Invalid --" + name + " value " + s + ", expected positive integer");
+    }
+    return result;
+}
+}  // namespace
+
+size_t ParseMemorySize(const std::string& s) {
+    const size_t kilobyte = 1024;
+    const std::string error = "Invalid --max-memory value " + s + ", expected bytes with optional K, M or G";
+    size_t digits = 0;
+    while (digits < s.size() && std::isdigit(s[digits])) {
+        digits++;
+    }
+    size_t result = 0;
+    if (digits + 1 < s.size() || !ParseUnsigned(s.substr(0, digits), result)) {
+        throw std::invalid_argument(error);
+    }
+    if (digits == s.size()) {
+        return result;
+    }
+    size_t multiplier = kilobyte;
+    switch (std::toupper(s[digits])) {
+        case 'G':
+            multiplier *= kilobyte;
+            [[fallthrough]];
+        case 'M':
+            multiplier *= kilobyte;
+            [[fallthrough]];
+        case 'K':
+            break;
+        default:
+            throw std::invalid_argument(error);
+    }
+    if (result > SIZE_MAX / multiplier) {
+        throw std::invalid_argument(error);
+    }
+    return result * multiplier;
+}
+
+size_t ParsePreviewScale(const std::string& s) {
+    return ParsePositiveOption(s, "preview");
+}
+
+size_t ParseThreadCount(const std::string& s) {
+    return ParsePositiveOption(s, "threads");
+}
+
+FilterChain CreateFilterChain(const std::vector<FilterArgs>& args) {
+    FilterChain result;
+    auto filters_map = GetFilters();
+    for (const FilterArgs& cur_arg : args) {
+        if (!filters_map.contains(cur_arg.name)) {
+            throw std::invalid_argument(std::format("Cant find filter with name {}", cur_arg.name));
+        }
+        result.push_back(filters_map[cur_arg.name](cur_arg.params));
+    }
+    return result;
+}
+
+void DownscaleChain(FilterChain& chain, size_t scale) {
+    if (scale == 1) {
+        return;
+    }
+    for (std::unique_ptr<Filter>& filter : chain) {
+        filter->Downscale(scale);
+    }
+}
+
+MemoryPlan PlanMemory(ImageSize input, const FilterChain& chain, size_t max_memory) {
+    KeepFramesMapped();
+    size_t resident = ResidentBytes();
+    size_t frames_memory = max_memory > resident ? max_memory - resident : 0;
+    if (ChainPeakBytes(input, chain) <= frames_memory) {
+        return MemoryPlan{0};
+    }
+    size_t low = 0;
+    size_t high = ChainOutputSize(input, chain).height;
+    while (low < high) {  // the tallest strip which fits, strip peak grows with its height
+        size_t middle = (low + high + 1) / 2;
+        if (StripPeakBytes(input, chain, middle) <= frames_memory) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (low == 0) {
+        throw std::invalid_argument(std::format("Job needs at least {} bytes, but --max-memory is {} bytes",
+                                                resident + StripPeakBytes(input, chain, 1), max_memory));
+    }
+    return MemoryPlan{low};
+}
+
+void RunChain(FilesPaths& files, const FilterChain& chain, const MemoryPlan& plan, size_t scale) {
+    if (plan.strip_rows == 0) {
+        RunWholeFrame(files, chain, scale);
+    } else {
+        RunInStrips(files, chain, plan.strip_rows, scale);
+    }
+}
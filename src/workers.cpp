@@ -0,0 +1,186 @@
+#include "Workers.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+struct Pool {
+    std::vector<std::thread> threads;
+    size_t bands = 1;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    const std::function<void(size_t, size_t)>* body = nullptr;
+    size_t rows = 0;
+    size_t generation = 0;
+    size_t pending = 0;
+    std::exception_ptr error;  // first exception thrown by a band of the current call
+    bool stop = false;
+
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        start.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+Pool pool;
+
+size_t BandBorder(size_t rows, size_t band) {
+    return rows * band / pool.bands;
+}
+
+// parses lists like "0-3,8-11" used by sysfs
+std::vector<int> ParseList(const std::string& s) {
+    std::vector<int> result;
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t comma = s.find(',', pos);
+        std::string range = s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        size_t dash = range.find('-');
+        if (!range.empty() && range.find_first_not_of("0123456789-") == std::string::npos) {
+            int first = std::stoi(range);
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int i = first; i <= last; i++) {
+                result.push_back(i);
+            }
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return result;
+}
+
+std::string ReadLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// CPUs of every NUMA node with CPUs, empty when the topology is unknown
+std::vector<std::vector<int>> ReadNumaNodes() {
+    std::vector<std::vector<int>> result;
+#ifdef __linux__
+    const std::string nodes_path = "/sys/devices/system/node/";
+    for (int node : ParseList(ReadLine(nodes_path + "online"))) {
+        std::vector<int> cpus = ParseList(ReadLine(nodes_path + "node" + std::to_string(node) + "/cpulist"));
+        if (!cpus.empty()) {
+            result.push_back(cpus);
+        }
+    }
+#endif
+    return result;
+}
+
+void PinToCpus(std::thread::native_handle_type handle, const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(handle, sizeof(set), &set);  // an unpinned worker is still correct, just slower
+#endif
+}
+
+void RunBand(size_t band, size_t rows, const std::function<void(size_t, size_t)>& body) {
+    size_t begin = BandBorder(rows, band);
+    size_t end = BandBorder(rows, band + 1);
+    if (begin >= end) {
+        return;
+    }
+    try {
+        body(begin, end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.error) {
+            pool.error = std::current_exception();
+        }
+    }
+}
+
+void WorkerLoop(size_t band) {
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while (true) {
+        pool.start.wait(lock, [&seen] { return pool.stop || pool.generation != seen; });
+        if (pool.stop) {
+            return;
+        }
+        seen = pool.generation;
+        const std::function<void(size_t, size_t)>& body = *pool.body;
+        size_t rows = pool.rows;
+        lock.unlock();
+        RunBand(band, rows, body);
+        lock.lock();
+        if (--pool.pending == 0) {
+            pool.done.notify_one();
+        }
+    }
+}
+}  // namespace
+
+void StartWorkers(size_t count) {
+    if (!pool.threads.empty()) {
+        return;
+    }
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::vector<int>> nodes = ReadNumaNodes();
+    bool pin = nodes.size() > 1;
+#ifdef __linux__
+    if (pin) {
+        PinToCpus(pthread_self(), nodes[0]);  // the calling thread runs band 0
+    }
+#endif
+    pool.bands = count;
+    for (size_t band = 1; band < count; band++) {
+        pool.threads.emplace_back(WorkerLoop, band);
+        if (pin) {
+            PinToCpus(pool.threads.back().native_handle(), nodes[band * nodes.size() / count]);
+        }
+    }
+}
+
+void ForEachBand(size_t rows, const std::function<void(size_t, size_t)>& body) {
+    if (pool.bands == 1 || rows < 2) {
+        if (rows > 0) {
+            body(0, rows);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.body = &body;
+        pool.rows = rows;
+        pool.pending = pool.threads.size();
+        pool.generation++;
+    }
+    pool.start.notify_all();
+    RunBand(0, rows, body);
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.done.wait(lock, [] { return pool.pending == 0; });  // workers use body until then, even after a throw
+    if (pool.error) {
+        std::rethrow_exception(std::exchange(pool.error, nullptr));
+    }
+}